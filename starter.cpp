@@ -1,5 +1,16 @@
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <random>
 #include <iostream>
+#include <sstream>
 #include <vector>
 // ifdef is a compiler flag, to control when the compiler will include specific lines of code
 // in this case, we are going to import windows headers only on windows systems
@@ -7,6 +18,43 @@
 #include <windows.h>
 #endif
 
+// ALLOC_GUARD is a debug flag that makes any heap allocation inside an AllocationGuard scope abort the program
+// build with `g++ -std=c++17 -g -rdynamic -DALLOC_GUARD starter.cpp` so the printed stack has function names
+#ifdef ALLOC_GUARD
+#include <new>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+// allocationGuardDepth is above zero while an AllocationGuard is alive on this thread
+static thread_local int allocationGuardDepth = 0;
+
+// every operator new (std::vector, std::string, new IGamePiece...) goes through this replacement
+void *operator new(std::size_t size) {
+  if (allocationGuardDepth > 0) {
+    allocationGuardDepth = 0; // printing the report may allocate itself
+    std::fprintf(stderr, "ALLOC_GUARD: %zu byte allocation inside a guarded region\n", size);
+#ifdef __GLIBC__
+    void *frames[64];
+    backtrace_symbols_fd(frames, backtrace(frames, 64), 2);
+#endif
+    std::abort();
+  }
+  if (void *memory = std::malloc(size == 0 ? 1 : size))
+    return memory;
+  throw std::bad_alloc();
+}
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+#endif
+
+// AllocationGuard marks a scope that must not allocate, it does nothing unless built with ALLOC_GUARD
+struct AllocationGuard {
+#ifdef ALLOC_GUARD
+  AllocationGuard() { allocationGuardDepth++; }
+  ~AllocationGuard() { allocationGuardDepth--; }
+#endif
+};
+
 // color code constants https://en.wikipedia.org/wiki/ANSI_escape_code#3-bit_and_4-bit
 // backgrounds
 const std::string BG_BLACK = "\033[40m";
@@ -58,12 +106,16 @@ struct Position {
   Position(int x, int y) : x(x), y(y) {}
 };
 
+struct PieceDefinition; // declared with the pieces below
+
 // IGamePiece represents a generic chess piece
 // all chess pieces inherit from this class
 class IGamePiece {
 public:
   // isWhite is a boolean to track what team the piece belongs to
   bool isWhite = false;
+  // hasMoved is set by BoardManager::movePiece once the piece leaves its starting square
+  bool hasMoved = false;
   // position represents the piece coordinates on the game board
   // this position will be updated by main() after every board update
   Position position = Position(0, 0);
@@ -73,6 +125,27 @@ public:
   virtual std::string render() = 0;
   // returns a vector of positions where the piece could move
   virtual std::vector<Position> getPotentialMoves() = 0;
+  // appends the positions where the piece could move to `moves`, reusing its capacity
+  // the default copies getPotentialMoves(), override it to generate without allocating (perft runs through this)
+  virtual void generateMoves(std::vector<Position> &moves) {
+    for (auto &move : getPotentialMoves())
+      moves.push_back(move);
+  }
+  // returns the positions the piece attacks or defends: every square it could capture on if an enemy piece stood there,
+  // including squares held by its own side, so the attack map can tell defended pieces from hanging ones
+  // the default returns getPotentialMoves(), which leaves defended squares out; every built-in piece overrides it
+  virtual std::vector<Position> getAttacks() { return getPotentialMoves(); }
+  // appends the positions getAttacks() would return to `attacks`, override it together with generateMoves
+  virtual void generateAttacks(std::vector<Position> &attacks) {
+    for (auto &attack : getAttacks())
+      attacks.push_back(attack);
+  }
+  // returns the material value of the piece in pawns, used by the analysis overlay
+  virtual int getValue() { return 0; }
+  // returns the setup letter createPiece uses for this piece (lowercase), or 0 if it cannot be recreated from a letter
+  virtual char getLetter() { return 0; }
+  // returns the compiled movement tables the piece generates from, or nullptr for hand-written pieces
+  virtual const PieceDefinition *getDefinition() { return nullptr; }
   virtual ~IGamePiece() = default;
 };
 
@@ -81,17 +154,139 @@ class BoardManager {
 private:
   std::vector<std::vector<IGamePiece *>> board; // 2D vector grid to represent the chessboard
 
+  // CastlingRight holds everything needed to check one castling option, precomputed by prepareBoard
+  // castling is entered as "king takes own rook" so it works for any Chess960 start position
+  struct CastlingRight {
+    IGamePiece *king;
+    IGamePiece *rook;
+    Position rookStart;
+    Position kingTarget;
+    Position rookTarget;
+    std::vector<Position> mustBeEmpty; // squares the king or rook pass over or land on, except their own start squares
+    std::vector<Position> mustBeSafe;  // squares the king starts on, passes over and lands on
+  };
+  std::vector<CastlingRight> castlingRights;
+
+  // pockets[isWhite][letter - 'a'] holds the captured pieces each side may drop in crazyhouse mode
+  // the captured objects themselves are kept and dropped again, so makeMove and perft never allocate for a drop
+  std::vector<IGamePiece *> pockets[2][26];
+  // pocketValue[isWhite] is the total material value held in each pocket
+  int pocketValue[2] = {};
+
+  // pocketPiece puts a captured piece into the pocket of side `isWhite`
+  // returns false for pieces that cannot be dropped again (kings and pieces without a setup letter)
+  bool pocketPiece(IGamePiece *piece, bool isWhite) {
+    char letter = piece->getLetter();
+    if (letter < 'a' || letter > 'z' || letter == 'k')
+      return false;
+    pockets[isWhite][letter - 'a'].push_back(piece); // prepareBoard reserves room for every piece on the board
+    pocketValue[isWhite] += piece->getValue();
+    return true;
+  }
+
+  // unpocketPiece takes the most recently pocketed piece with setup letter `letter` out of the pocket of side `isWhite`
+  IGamePiece *unpocketPiece(char letter, bool isWhite) {
+    IGamePiece *piece = pockets[isWhite][letter - 'a'].back();
+    pockets[isWhite][letter - 'a'].pop_back();
+    pocketValue[isWhite] -= piece->getValue();
+    return piece;
+  }
+
+  // attackBuffer is scratch space for isAttacked, kept between calls so it keeps its capacity
+  std::vector<Position> attackBuffer;
+
+  // trackAttacks keeps attackMap current across makeMove, unmakeMove and dropPiece, see setAttackTracking
+  bool trackAttacks = false;
+
+  // dependsOn returns true if what `piece` attacks can change when the occupancy of `square` changes
+  // pieces without compiled tables are always recomputed
+  bool dependsOn(IGamePiece *piece, Position square);
+
+  // updateAttacks brackets a board change for attack tracking: call it with `adding` false before the change and
+  // true after it, it removes or adds the attacks of every piece standing on or depending on one of the changed squares
+  void updateAttacks(const Position *changed, int changedCount, bool adding) {
+    int height = getHeight();
+    int sign = adding ? 1 : -1;
+    for (auto &column : board) {
+      for (IGamePiece *piece : column) {
+        if (piece == nullptr)
+          continue;
+        bool affected = false;
+        for (int i = 0; i < changedCount && !affected; i++) {
+          affected = (piece->position.x == changed[i].x && piece->position.y == changed[i].y) || dependsOn(piece, changed[i]);
+        }
+        if (!affected)
+          continue;
+        attackBuffer.clear();
+        piece->generateAttacks(attackBuffer);
+        for (auto &attack : attackBuffer)
+          attackMap.counts[piece->isWhite][attack.x * height + attack.y] += sign;
+        attackMap.mobility[piece->isWhite] += sign * countMobility(piece, attackBuffer);
+      }
+    }
+  }
+
+  // countMobility returns how many of a piece's attacked squares are not held by its own side
+  // defended squares count in the attack map but are not squares the piece could go to
+  int countMobility(IGamePiece *piece, const std::vector<Position> &attacks) {
+    int mobility = 0;
+    for (auto &attack : attacks) {
+      IGamePiece *target = board[attack.x][attack.y];
+      mobility += target == nullptr || target->isWhite != piece->isWhite;
+    }
+    return mobility;
+  }
+
+  // addCastlingRight precomputes the squares to check for castling the king at kingX with the rook at rookX
+  // the king lands on the third column from its side and the rook right next to it, as in standard chess
+  void addCastlingRight(int kingX, int rookX, int row) {
+    bool kingSide = rookX > kingX;
+    int kingTargetX = kingSide ? getWidth() - 2 : 2;
+    int rookTargetX = kingSide ? kingTargetX - 1 : kingTargetX + 1;
+    if (!isOnBoard(kingTargetX, row) || !isOnBoard(rookTargetX, row))
+      return; // board too narrow to castle
+    CastlingRight right = {board[kingX][row], board[rookX][row], Position(rookX, row), Position(kingTargetX, row),
+                           Position(rookTargetX, row), {}, {}};
+    int left = std::min({kingX, rookX, kingTargetX, rookTargetX});
+    int rightmost = std::max({kingX, rookX, kingTargetX, rookTargetX});
+    for (int x = left; x <= rightmost; x++) {
+      if (x != kingX && x != rookX)
+        right.mustBeEmpty.push_back(Position(x, row));
+    }
+    for (int x = std::min(kingX, kingTargetX); x <= std::max(kingX, kingTargetX); x++)
+      right.mustBeSafe.push_back(Position(x, row));
+    castlingRights.push_back(right);
+  }
+
 public:
+  // crazyhouse sends captured pieces to the capturer's pocket instead of deleting them, see dropPiece
+  bool crazyhouse = false;
+
   // prepareBoard creates a chessboard data structure
+  // `backRank` lists the pieces on the first row from left to right (one letter per column, see createPiece)
+  // every letter must be known to createPiece, main checks this before calling
+  // so the board is backRank.size() columns wide and `height` rows tall, with a row of pawns in front of each back rank
   //  implement this *after* all gamePiece declarations so that they can be referenced
-  void prepareBoard();
+  void prepareBoard(const std::string &backRank = "rnbqkbnr", int height = 8);
 
   // getAtPosition returns a pointer to the IGamePiece located at the specified position on the board
   IGamePiece *const getAtPosition(int row, int col) { return board[row][col]; }
 
+  // getWidth returns the number of columns on the board
+  int getWidth() { return board.size(); }
+
+  // getHeight returns the number of rows on the board
+  int getHeight() { return board.empty() ? 0 : board[0].size(); }
+
+  // isOnBoard returns true if the coordinates are inside the board
+  bool isOnBoard(int x, int y) { return x >= 0 && x < getWidth() && y >= 0 && y < getHeight(); }
+
   // renderBoard prints a colored grid to the terminal representing a chessboard with pieces
   // this also adds highlights for the cursor, selected pieces, and potential moves when applicable
-  void renderBoard(Position cursor, IGamePiece *selectedPiece, std::vector<Position> moves) {
+  // pieces on `threats` positions are drawn in red text to show they can be captured
+  // `out` defaults to the terminal but can be any stream (the replay driver renders into memory)
+  void renderBoard(Position cursor, IGamePiece *selectedPiece, std::vector<Position> moves, std::vector<Position> threats,
+                   std::ostream &out = std::cout) {
     int rows = board.size();
     // set `cols` (columns) is zero if there are no rows, prevents crash with empty boards.
     int cols = rows == 0 ? 0 : board[0].size();
@@ -100,29 +295,158 @@ public:
       for (int row = 0; row < rows; row++) {
         for (auto &move : moves) { // if a position is in the potential move set, highlight positions in red
           if (move.x == row && move.y == col) {
-            std::cout << BG_RED;
+            out << BG_RED;
             break;
           }
         }
         if (selectedPiece != nullptr) { // if a piece is currently selected, highlight it in green
           if (selectedPiece->position.x == row && selectedPiece->position.y == col)
-            std::cout << BG_GREEN;
+            out << BG_GREEN;
         }
         bool highlighted = (row == cursor.x && col == cursor.y);
         if (highlighted) // use white background to create highlight effect to represent the cursor
-          std::cout << BG_WHITE;
+          out << BG_WHITE;
         if (board[row][col] == nullptr) { // print empty space characters
-          std::cout << EMPTY;
+          out << EMPTY;
         } else {
+          for (auto &threat : threats) { // if the piece is under attack, print it in red
+            if (threat.x == row && threat.y == col) {
+              out << RED;
+              break;
+            }
+          }
           // print icon for piece at current position
-          std::cout << board[row][col]->render();
+          out << board[row][col]->render();
           // update piece position data to match current board position
           board[row][col]->position = Position(row, col);
         }
-        std::cout << CLEAR << BG_BLACK; // reset text and background colors back to default
+        out << CLEAR << BG_BLACK; // reset text and background colors back to default
       }
-      std::cout << '\r' << std::endl; // begin next row
+      out << '\r' << std::endl; // begin next row
+    }
+  }
+
+  // MoveUndo remembers everything makeMove or makeDrop changed so unmakeMove can restore the board exactly
+  struct MoveUndo {
+    IGamePiece *piece;    // the piece that moved
+    Position from;        // where it came from, or the drop square for a drop
+    IGamePiece *captured; // the piece that was taken off the board, or nullptr
+    bool hadMoved;        // piece->hasMoved before the move
+    IGamePiece *rook;     // the castling rook, or nullptr if the move was not a castle
+    Position rookFrom;    // where the castling rook came from
+    bool rookHadMoved;    // rook->hasMoved before the move
+    char dropLetter;      // setup letter of the dropped piece, or 0 if the move was not a drop
+    bool pocketed;        // the captured piece went into the mover's pocket instead of just off the board
+  };
+
+  // makeMove plays a move without checking it and returns what is needed to take it back
+  // unlike movePiece, a captured piece is never deleted: it stays alive in the MoveUndo, or in the pocket in crazyhouse
+  MoveUndo makeMove(IGamePiece *piece, Position target) {
+    MoveUndo undo = {piece, piece->position, nullptr, piece->hasMoved, nullptr, Position(0, 0), false, 0, false};
+    // a king moving onto its own rook castles
+    // the color check matters in crazyhouse: a captured rook is dropped again as the enemy's piece and the king must capture it
+    CastlingRight *castle = nullptr;
+    for (auto &right : castlingRights) {
+      if (right.king == piece && right.rook == board[target.x][target.y] && right.rook->isWhite == piece->isWhite) {
+        castle = &right;
+        break;
+      }
+    }
+    // squares whose occupancy changes, attack tracking recomputes the pieces that stand on or see them
+    Position changed[4] = {undo.from, target, target, target};
+    int changedCount = 2;
+    if (castle != nullptr) {
+      changed[2] = castle->kingTarget;
+      changed[3] = castle->rookTarget;
+      changedCount = 4;
+    }
+    if (trackAttacks)
+      updateAttacks(changed, changedCount, false);
+    if (castle != nullptr) {
+      undo.rook = castle->rook;
+      undo.rookFrom = castle->rook->position;
+      undo.rookHadMoved = castle->rook->hasMoved;
+      // empty both start squares first, the king may land where the rook stood
+      board[piece->position.x][piece->position.y] = nullptr;
+      board[target.x][target.y] = nullptr;
+      board[castle->kingTarget.x][castle->kingTarget.y] = castle->king;
+      board[castle->rookTarget.x][castle->rookTarget.y] = castle->rook;
+      castle->king->position = castle->kingTarget;
+      castle->rook->position = castle->rookTarget;
+      castle->king->hasMoved = true;
+      castle->rook->hasMoved = true;
+    } else {
+      undo.captured = board[target.x][target.y];
+      board[target.x][target.y] = piece;         // update pointer at new board position to point to gamePiece
+      board[undo.from.x][undo.from.y] = nullptr; // delete reference to piece at original board position
+      piece->position = target;                  // keep the piece position in sync so analysis sees the new board
+      piece->hasMoved = true;
+      // in crazyhouse the capturer may drop the piece later, kings are never pocketed
+      if (crazyhouse && undo.captured != nullptr)
+        undo.pocketed = pocketPiece(undo.captured, piece->isWhite);
+    }
+    if (trackAttacks)
+      updateAttacks(changed, changedCount, true);
+    return undo;
+  }
+
+  // makeDrop drops the last pocketed piece with setup letter `letter` of side `isWhite` on the empty square `target`
+  // without checking it, and returns what unmakeMove needs to put the piece back in the pocket
+  MoveUndo makeDrop(char letter, bool isWhite, Position target) {
+    if (trackAttacks)
+      updateAttacks(&target, 1, false);
+    IGamePiece *piece = unpocketPiece(letter, isWhite);
+    MoveUndo undo = {piece, target, nullptr, piece->hasMoved, nullptr, Position(0, 0), false, letter, false};
+    piece->isWhite = isWhite; // a pocketed piece still has the color of the side it was captured from
+    piece->position = target;
+    // a dropped rook may not castle, but a pawn dropped on its own second row may still double step like any unmoved pawn
+    piece->hasMoved = letter == 'k' || letter == 'r';
+    board[target.x][target.y] = piece;
+    if (trackAttacks)
+      updateAttacks(&target, 1, true);
+    return undo;
+  }
+
+  // unmakeMove takes back a move played by makeMove, moves must be taken back in reverse order
+  void unmakeMove(const MoveUndo &undo) {
+    if (undo.dropLetter != 0) { // take a drop back into the pocket
+      Position square = undo.from;
+      if (trackAttacks)
+        updateAttacks(&square, 1, false);
+      board[square.x][square.y] = nullptr;
+      undo.piece->hasMoved = undo.hadMoved;
+      pocketPiece(undo.piece, undo.piece->isWhite);
+      if (trackAttacks)
+        updateAttacks(&square, 1, true);
+      return;
+    }
+    Position to = undo.piece->position;
+    Position changed[4] = {undo.from, to, to, to};
+    int changedCount = 2;
+    if (undo.rook != nullptr) {
+      changed[2] = undo.rookFrom;
+      changed[3] = undo.rook->position;
+      changedCount = 4;
     }
+    if (trackAttacks)
+      updateAttacks(changed, changedCount, false);
+    if (undo.pocketed) { // every later drop has been taken back, so the captured piece is the last one in the pocket
+      unpocketPiece(undo.captured->getLetter(), undo.piece->isWhite);
+      undo.captured->isWhite = !undo.piece->isWhite;
+      undo.captured->position = to;
+    }
+    board[to.x][to.y] = undo.captured; // put the captured piece back, or clear the square
+    if (undo.rook != nullptr) {        // undo a castle, the rook square may overlap the king's start square
+      board[undo.rook->position.x][undo.rook->position.y] = nullptr;
+      board[undo.rookFrom.x][undo.rookFrom.y] = undo.rook;
+      undo.rook->position = undo.rookFrom;
+      undo.rook->hasMoved = undo.rookHadMoved;
+    }
+    board[undo.from.x][undo.from.y] = undo.piece;
+    undo.piece->position = undo.from;
+    undo.piece->hasMoved = undo.hadMoved;
+    if (trackAttacks)
+      updateAttacks(changed, changedCount, true);
   }
 
   // movePiece moves an IGamePiece to a new position on the board
@@ -138,18 +462,235 @@ public:
     }
     if (!isValidMove)
       return false;
-    // delete existing piece at new position if present
-    if (board[target.x][target.y] != nullptr) {
-      delete board[target.x][target.y];
-      board[target.x][target.y] = nullptr;
+    MoveUndo undo = makeMove(piece, target);
+    // delete the captured piece, if any, unless it went into a pocket
+    if (undo.captured != nullptr) {
+      IGamePiece *captured = undo.captured;
+      // forget castling rights that refer to the captured piece
+      castlingRights.erase(std::remove_if(castlingRights.begin(), castlingRights.end(),
+                                          [&](const CastlingRight &right) { return right.king == captured || right.rook == captured; }),
+                           castlingRights.end());
+      if (!undo.pocketed)
+        delete captured;
     }
-    // perform move
-    Position oldPos = piece->position;
-    board[target.x][target.y] = piece;   // update pointer at new board position to point to gamePiece
-    board[oldPos.x][oldPos.y] = nullptr; // delete reference to piece at original board position
     return true;
   }
 
+  // perft counts the leaf nodes of the move tree `depth` plies deep, starting with `whiteToMove`
+  // kings can be captured in this game, so every potential move counts and nothing is filtered for check
+  // in crazyhouse every drop of a pocketed piece counts as a move too
+  // `buffers` needs one move list per remaining ply, reserve them up front so the walk does not allocate
+  //  implement this *after* all gamePiece declarations so that their generateMoves overrides are visible
+  unsigned long long perft(int depth, bool whiteToMove, std::vector<std::vector<Position>> &buffers);
+
+  // getPocketCount returns how many pieces with setup letter `letter` the side can drop
+  int getPocketCount(char letter, bool isWhite) {
+    return letter >= 'a' && letter <= 'z' ? pockets[isWhite][letter - 'a'].size() : 0;
+  }
+
+  // getDropSquares returns every square a pocketed piece with setup letter `letter` may be dropped on
+  // that is any empty square, except that pawns may not be dropped on the first or last row
+  // this allocates a new list on every call, move generation in perft uses appendDropSquares instead
+  std::vector<Position> getDropSquares(char letter) {
+    std::vector<Position> squares;
+    for (int x = 0; x < getWidth(); x++) {
+      for (int y = 0; y < getHeight(); y++) {
+        bool pawnForbidden = letter == 'p' && (y == 0 || y == getHeight() - 1);
+        if (board[x][y] == nullptr && !pawnForbidden)
+          squares.push_back(Position(x, y));
+      }
+    }
+    return squares;
+  }
+
+  // appendDropSquares appends the squares getDropSquares would return to `squares`, reusing its capacity like generateMoves
+  // the row range is narrowed once for pawns so the inner loop only tests for empty squares
+  void appendDropSquares(char letter, std::vector<Position> &squares) {
+    int firstRow = letter == 'p' ? 1 : 0;
+    int lastRow = letter == 'p' ? getHeight() - 2 : getHeight() - 1;
+    for (int x = 0; x < getWidth(); x++) {
+      const std::vector<IGamePiece *> &column = board[x];
+      for (int y = firstRow; y <= lastRow; y++) {
+        if (column[y] == nullptr)
+          squares.push_back(Position(x, y));
+      }
+    }
+  }
+
+  // dropPiece places a piece from the side's pocket on an empty square
+  // returns true on success
+  bool dropPiece(char letter, bool isWhite, Position target) {
+    if (getPocketCount(letter, isWhite) == 0)
+      return false;
+    // check that the drop is valid (by checking that the target is in the drop squares list)
+    for (auto &square : getDropSquares(letter)) {
+      if (square.x == target.x && square.y == target.y) {
+        makeDrop(letter, isWhite, target);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // isAttacked returns true if any piece of the given color could capture on `square`, or defends it if one of its own pieces stands there
+  // castling only asks about squares the attacking side does not occupy, so there it means an enemy could capture
+  // `reference` uses the getAttacks() oracle instead of generateAttacks(), so --difftest can compare both
+  bool isAttacked(Position square, bool byWhite, bool reference = false) {
+    if (trackAttacks && !reference)
+      return attackMap.counts[byWhite][square.x * getHeight() + square.y] > 0;
+    for (auto &column : board) {
+      for (IGamePiece *piece : column) {
+        if (piece == nullptr || piece->isWhite != byWhite)
+          continue;
+        if (reference) {
+          for (auto &attack : piece->getAttacks()) {
+            if (attack.x == square.x && attack.y == square.y)
+              return true;
+          }
+          continue;
+        }
+        attackBuffer.clear(); // reused so castling checks inside perft do not allocate
+        piece->generateAttacks(attackBuffer);
+        for (auto &attack : attackBuffer) {
+          if (attack.x == square.x && attack.y == square.y)
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // appendCastlingMoves appends the positions of the rooks `king` may castle with (moving the king onto the rook castles)
+  void appendCastlingMoves(IGamePiece *king, std::vector<Position> &moves, bool reference = false) {
+    for (auto &right : castlingRights) {
+      // the rook must still be on its start square, makeMove keeps captured rooks alive off the board
+      if (right.king != king || king->hasMoved || board[right.rookStart.x][right.rookStart.y] != right.rook || right.rook->hasMoved)
+        continue;
+      // the cheap occupancy checks run first so attack detection only happens when castling is otherwise possible
+      bool pathClear = true;
+      for (auto &square : right.mustBeEmpty)
+        pathClear = pathClear && board[square.x][square.y] == nullptr;
+      if (!pathClear)
+        continue;
+      bool pathSafe = true;
+      for (auto &square : right.mustBeSafe)
+        pathSafe = pathSafe && !isAttacked(square, !king->isWhite, reference);
+      if (pathSafe)
+        moves.push_back(right.rookStart);
+    }
+  }
+
+  // getCastlingMoves returns the castling moves of `king` using the reference attack oracle
+  std::vector<Position> getCastlingMoves(IGamePiece *king) {
+    std::vector<Position> moves;
+    appendCastlingMoves(king, moves, true);
+    return moves;
+  }
+
+  // AttackMap counts, for both sides at once, how many pieces attack every square, defended own pieces included
+  // along with the mobility and king safety terms the analysis overlay derives from it
+  struct AttackMap {
+    std::vector<int> counts[2];  // counts[isWhite][x * height + y] is the number of that side's pieces attacking or defending (x, y)
+    int mobility[2] = {};        // attacked squares not held by the own side, summed over every piece of each side
+    int kingZoneAttacks[2] = {}; // enemy attacks on the squares around each side's king, including the king's own square
+                                 // and squares where the enemy defends its own pieces
+  };
+
+private:
+  // attackMap is only kept current while trackAttacks is on, its king zone terms are filled in by getAttackMap
+  AttackMap attackMap;
+
+public:
+
+  // computeAttackMap builds the attack map for the whole board in a single pass over the pieces
+  AttackMap computeAttackMap() {
+    AttackMap map;
+    int height = getHeight();
+    map.counts[0].assign(getWidth() * height, 0);
+    map.counts[1].assign(getWidth() * height, 0);
+    for (auto &column : board) {
+      for (IGamePiece *piece : column) {
+        if (piece == nullptr)
+          continue;
+        attackBuffer.clear();
+        piece->generateAttacks(attackBuffer);
+        for (auto &attack : attackBuffer)
+          map.counts[piece->isWhite][attack.x * height + attack.y]++;
+        map.mobility[piece->isWhite] += countMobility(piece, attackBuffer);
+      }
+    }
+    fillKingZoneAttacks(map);
+    return map;
+  }
+
+  // fillKingZoneAttacks reads the king zone terms straight from the finished counts, no attack generation needed
+  void fillKingZoneAttacks(AttackMap &map) {
+    int height = getHeight();
+    map.kingZoneAttacks[0] = map.kingZoneAttacks[1] = 0;
+    for (auto &column : board) {
+      for (IGamePiece *piece : column) {
+        if (piece == nullptr || piece->getLetter() != 'k')
+          continue;
+        for (int x = piece->position.x - 1; x <= piece->position.x + 1; x++) {
+          for (int y = piece->position.y - 1; y <= piece->position.y + 1; y++) {
+            if (isOnBoard(x, y))
+              map.kingZoneAttacks[piece->isWhite] += map.counts[!piece->isWhite][x * height + y];
+          }
+        }
+      }
+    }
+  }
+
+  // setAttackTracking turns the incrementally updated attack map on or off
+  // while it is on, makeMove, unmakeMove and dropPiece keep it current and isAttacked becomes a table lookup
+  void setAttackTracking(bool enabled) {
+    trackAttacks = enabled;
+    if (enabled)
+      attackMap = computeAttackMap();
+  }
+
+  // isTrackingAttacks returns true while the attack map is kept up to date
+  bool isTrackingAttacks() { return trackAttacks; }
+
+  // getAttackMap returns the tracked attack map with its king zone terms filled in
+  AttackMap getAttackMap() {
+    AttackMap map = attackMap;
+    fillKingZoneAttacks(map);
+    return map;
+  }
+
+  // isHanging returns true if the piece on `square` is attacked by the enemy and defended by none of its own pieces
+  bool isHanging(const AttackMap &map, Position square) {
+    IGamePiece *piece = board[square.x][square.y];
+    int index = square.x * getHeight() + square.y;
+    return piece != nullptr && map.counts[!piece->isWhite][index] > 0 && map.counts[piece->isWhite][index] == 0;
+  }
+
+  // getThreatenedSquares returns the positions of all pieces that an enemy piece could capture
+  std::vector<Position> getThreatenedSquares(const AttackMap &map) {
+    std::vector<Position> threats;
+    for (int x = 0; x < getWidth(); x++) {
+      for (int y = 0; y < getHeight(); y++) {
+        IGamePiece *piece = board[x][y];
+        if (piece != nullptr && map.counts[!piece->isWhite][x * getHeight() + y] > 0)
+          threats.push_back(Position(x, y));
+      }
+    }
+    return threats;
+  }
+
+  // getMaterialBalance returns white material minus black material, in pawns, including pocketed pieces
+  int getMaterialBalance() {
+    int balance = pocketValue[true] - pocketValue[false];
+    for (auto &column : board) {
+      for (IGamePiece *piece : column) {
+        if (piece != nullptr)
+          balance += piece->isWhite ? piece->getValue() : -piece->getValue();
+      }
+    }
+    return balance;
+  }
+
   // you may want to add more helper functionality here, such as checking if the a position is valid on the board
 };
 
@@ -157,6 +698,7 @@ public:
 // so all gamePiece implemenentations can access this object
 static BoardManager boardManager;
 
+// custom pieces can also be declared without any code, see PieceDefinition below
 /* example
 class Plusser : public IGamePiece {
 public:
@@ -186,7 +728,7 @@ public:
       int y = move[1];
 
       // Check if the move is within the bounds of the board
-      if (x >= 0 && x < 8 && y >= 0 && y < 8) {
+      if (boardManager.isOnBoard(x, y)) {
         IGamePiece *targetPiece = boardManager.getAtPosition(x, y);
         // If there is a piece at the target position, check if it belongs to the same team
         if (targetPiece != nullptr && targetPiece->isWhite == this->isWhite) {
@@ -200,6 +742,228 @@ public:
   }
 };
 */
+// PieceMovement is one component of a custom piece's movement
+// e.g. "slides along (1, 0)" for a rook or "jumps by (1, 2)" for a knight
+struct PieceMovement {
+  enum Kind {
+    Leap, // jumps straight to position + offset
+    Ride, // slides along offset until blocked
+    Hop   // slides along offset to the first piece (the hurdle) and lands right behind it
+  };
+  Kind kind = Leap;
+  Position offset = Position(0, 0);
+  bool canMove = true;    // may land on an empty square
+  bool canCapture = true; // may land on an enemy piece
+  bool symmetric = true;  // also use every rotation and reflection of offset, otherwise offset is from white's side
+};
+
+// PieceDefinition declares a piece's movement without writing a getPotentialMoves subclass
+// compile() turns the movements into precomputed per-square tables so generators never walk off the board
+struct PieceDefinition {
+  char letter = 0;         // setup letter used by prepareBoard (lowercase)
+  std::string name;        // e.g. "Archbishop", used by getName
+  int value = 0;           // material value in pawns
+  std::string whiteSymbol; // render() output for white, e.g. "a "
+  std::string blackSymbol; // render() output for black, e.g. "A "
+  std::vector<PieceMovement> movements;
+
+  PieceDefinition() = default;
+  // the compiled tables below are left empty until compile() is called
+  PieceDefinition(char letter, const std::string &name, int value, const std::string &whiteSymbol,
+                  const std::string &blackSymbol, const std::vector<PieceMovement> &movements)
+      : letter(letter), name(name), value(value), whiteSymbol(whiteSymbol), blackSymbol(blackSymbol), movements(movements) {}
+
+  // CompiledRay is a list of on-board squares for one movement direction from one square (a leap is a single square)
+  struct CompiledRay {
+    PieceMovement::Kind kind;
+    bool canMove;
+    bool canCapture;
+    std::vector<Position> squares;
+  };
+  // rays[isWhite][x * height + y] lists every ray for a piece of that color standing on (x, y)
+  std::vector<std::vector<CompiledRay>> rays[2];
+  // reach[isWhite][from * squares + to] is true if square `to` lies on one of the rays from square `from`
+  // (squares are numbered x * height + y), only changes on those squares can change what the piece attacks
+  std::vector<bool> reach[2];
+
+  // compile builds the ray tables for a width x height board, call again whenever the board size changes
+  void compile(int width, int height) {
+    for (int color = 0; color < 2; color++) {
+      rays[color] = std::vector<std::vector<CompiledRay>>(width * height);
+      reach[color].assign(width * height * width * height, false);
+      for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+          for (auto &movement : movements) {
+            for (auto &offset : expandOffsets(movement, color == 1)) {
+              CompiledRay ray = {movement.kind, movement.canMove, movement.canCapture, {}};
+              int targetX = x + offset.x;
+              int targetY = y + offset.y;
+              while (targetX >= 0 && targetX < width && targetY >= 0 && targetY < height) {
+                ray.squares.push_back(Position(targetX, targetY));
+                if (movement.kind == PieceMovement::Leap)
+                  break; // a leap only reaches one square
+                targetX += offset.x;
+                targetY += offset.y;
+              }
+              for (auto &square : ray.squares)
+                reach[color][(x * height + y) * width * height + square.x * height + square.y] = true;
+              if (!ray.squares.empty())
+                rays[color][x * height + y].push_back(ray);
+            }
+          }
+        }
+      }
+    }
+  }
+
+private:
+  // expandOffsets returns the distinct directions a movement covers for one color
+  static std::vector<Position> expandOffsets(const PieceMovement &movement, bool isWhite) {
+    int dx = movement.offset.x;
+    int dy = movement.offset.y;
+    if (!movement.symmetric) // offsets are written from white's side, black moves the other way
+      return {Position(dx, isWhite ? dy : -dy)};
+    std::vector<Position> offsets;
+    int variants[8][2] = {{dx, dy}, {-dx, dy}, {dx, -dy}, {-dx, -dy}, {dy, dx}, {-dy, dx}, {dy, -dx}, {-dy, -dx}};
+    for (auto variant : variants) {
+      bool seen = false;
+      for (auto &offset : offsets)
+        seen = seen || (offset.x == variant[0] && offset.y == variant[1]);
+      if (!seen)
+        offsets.push_back(Position(variant[0], variant[1]));
+    }
+    return offsets;
+  }
+};
+
+// walkCompiledRays appends the moves of `piece` from its compiled rays to `moves` without allocating
+// (as long as `moves` has capacity), or every square a capturing ray reaches when `attacksOnly` is set,
+// including the square of a blocking piece of either color (an own piece there is defended)
+void walkCompiledRays(const PieceDefinition &definition, IGamePiece *piece, std::vector<Position> &moves, bool attacksOnly) {
+  auto &rays = definition.rays[piece->isWhite][piece->position.x * boardManager.getHeight() + piece->position.y];
+  for (auto &ray : rays) {
+    if (attacksOnly && !ray.canCapture)
+      continue;
+    bool canMove = ray.canMove || attacksOnly; // empty squares count as attacked along capturing rays
+    if (ray.kind == PieceMovement::Hop) {
+      // skip empty squares up to the hurdle, then the piece may only land directly behind it
+      size_t hurdle = 0;
+      while (hurdle < ray.squares.size() && boardManager.getAtPosition(ray.squares[hurdle].x, ray.squares[hurdle].y) == nullptr)
+        hurdle++;
+      if (hurdle + 1 >= ray.squares.size())
+        continue; // no hurdle, or the hurdle is on the edge of the board
+      Position landing = ray.squares[hurdle + 1];
+      IGamePiece *targetPiece = boardManager.getAtPosition(landing.x, landing.y);
+      if ((targetPiece == nullptr && canMove) ||
+          (targetPiece != nullptr && (attacksOnly || (targetPiece->isWhite != piece->isWhite && ray.canCapture))))
+        moves.push_back(landing);
+      continue;
+    }
+    // leaps and rides: every empty square is a move until a piece blocks the ray
+    for (auto &square : ray.squares) {
+      IGamePiece *targetPiece = boardManager.getAtPosition(square.x, square.y);
+      if (targetPiece == nullptr) {
+        if (canMove)
+          moves.push_back(square);
+        continue;
+      }
+      if (attacksOnly || (targetPiece->isWhite != piece->isWhite && ray.canCapture))
+        moves.push_back(square); // capture an enemy piece or defend an own one, then stop
+      break;
+    }
+  }
+}
+
+// walkMovements is the slow reference for walkCompiledRays, it returns the same squares by stepping along every
+// movement offset with isOnBoard and never reads the compiled tables, so --difftest checks compile() as well
+std::vector<Position> walkMovements(const PieceDefinition &definition, IGamePiece *piece, bool attacksOnly) {
+  std::vector<Position> moves;
+  for (auto &movement : definition.movements) {
+    if (attacksOnly && !movement.canCapture)
+      continue;
+    bool canMove = movement.canMove || attacksOnly;
+    // the directions this movement covers, every rotation and reflection of the offset only once
+    int dx = movement.offset.x;
+    int dy = movement.offset.y;
+    std::vector<Position> directions;
+    if (!movement.symmetric) {
+      directions.push_back(Position(dx, piece->isWhite ? dy : -dy)); // offsets are written from white's side
+    } else {
+      for (bool swap : {false, true}) {
+        for (int signX : {1, -1}) {
+          for (int signY : {1, -1}) {
+            Position direction(signX * (swap ? dy : dx), signY * (swap ? dx : dy));
+            bool seen = false;
+            for (auto &other : directions)
+              seen = seen || (other.x == direction.x && other.y == direction.y);
+            if (!seen)
+              directions.push_back(direction);
+          }
+        }
+      }
+    }
+    for (auto &direction : directions) {
+      int x = piece->position.x + direction.x;
+      int y = piece->position.y + direction.y;
+      if (movement.kind == PieceMovement::Hop) {
+        // find the hurdle, then land on the square right behind it
+        while (boardManager.isOnBoard(x, y) && boardManager.getAtPosition(x, y) == nullptr) {
+          x += direction.x;
+          y += direction.y;
+        }
+        x += direction.x;
+        y += direction.y;
+        if (!boardManager.isOnBoard(x, y))
+          continue; // no hurdle, or nothing behind it
+        IGamePiece *targetPiece = boardManager.getAtPosition(x, y);
+        if ((targetPiece == nullptr && canMove) ||
+            (targetPiece != nullptr && (attacksOnly || (targetPiece->isWhite != piece->isWhite && movement.canCapture))))
+          moves.push_back(Position(x, y));
+        continue;
+      }
+      // leaps stop after one square, rides keep going until they leave the board or reach a piece
+      while (boardManager.isOnBoard(x, y)) {
+        IGamePiece *targetPiece = boardManager.getAtPosition(x, y);
+        if (targetPiece != nullptr) {
+          if (attacksOnly || (targetPiece->isWhite != piece->isWhite && movement.canCapture))
+            moves.push_back(Position(x, y));
+          break;
+        }
+        if (canMove)
+          moves.push_back(Position(x, y));
+        if (movement.kind == PieceMovement::Leap)
+          break;
+        x += direction.x;
+        y += direction.y;
+      }
+    }
+  }
+  return moves;
+}
+
+// dependsOn is implemented here because it needs the complete PieceDefinition
+bool BoardManager::dependsOn(IGamePiece *piece, Position square) {
+  const PieceDefinition *definition = piece->getDefinition();
+  if (definition == nullptr)
+    return true;
+  int squares = getWidth() * getHeight();
+  return definition->reach[piece->isWhite][(piece->position.x * getHeight() + piece->position.y) * squares +
+                                            square.x * getHeight() + square.y];
+}
+
+// the built-in pieces generate through compiled tables too (see generateMoves), only the movement fields are used
+// their hand-written getPotentialMoves stay as the slow reference that `--difftest` checks the tables against
+static PieceDefinition kingDefinition = {'k', "King", 0, "", "", {{PieceMovement::Leap, Position(1, 0)}, {PieceMovement::Leap, Position(1, 1)}}};
+static PieceDefinition knightDefinition = {'n', "Knight", 3, "", "", {{PieceMovement::Leap, Position(1, 2)}}};
+static PieceDefinition bishopDefinition = {'b', "Bishop", 3, "", "", {{PieceMovement::Ride, Position(1, 1)}}};
+static PieceDefinition rookDefinition = {'r', "Rook", 5, "", "", {{PieceMovement::Ride, Position(1, 0)}}};
+static PieceDefinition queenDefinition = {'q', "Queen", 9, "", "", {{PieceMovement::Ride, Position(1, 0)}, {PieceMovement::Ride, Position(1, 1)}}};
+// pawns step forward without capturing and capture diagonally forward, the double step is added by Pawn::generateMoves
+static PieceDefinition pawnDefinition = {'p', "Pawn", 1, "", "",
+                                         {{PieceMovement::Leap, Position(0, -1), true, false, false},
+                                          {PieceMovement::Leap, Position(1, -1), false, true, false},
+                                          {PieceMovement::Leap, Position(-1, -1), false, true, false}}};
+
 class King : public IGamePiece {
 public:
   King(bool isWhite, int x, int y) {
@@ -217,7 +981,25 @@ public:
     return isWhite ? KING : BK_KING; // Using ASCII for display
   }
 
-  // Override getPotentialMoves to return possible moves for a King
+  // Override getLetter to return the setup letter of a King
+  char getLetter() override { return 'k'; }
+
+  // Override getDefinition to return the compiled King table
+  const PieceDefinition *getDefinition() override { return &kingDefinition; }
+
+  // Override getAttacks to return the squares the king attacks or defends, castling never captures
+  std::vector<Position> getAttacks() override { return walkMovements(kingDefinition, this, true); }
+
+  // Override generateMoves to append the table-driven steps and the castling moves without allocating
+  void generateMoves(std::vector<Position> &moves) override {
+    walkCompiledRays(kingDefinition, this, moves, false);
+    boardManager.appendCastlingMoves(this, moves);
+  }
+
+  // Override generateAttacks to append the table-driven steps
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(kingDefinition, this, attacks, true); }
+
+  // Override getPotentialMoves to return the king steps plus any castling moves
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
     
@@ -230,7 +1012,7 @@ public:
       int y = position.y + move[1];
 
       // Check if the move is within the bounds of the board
-      if (x >= 0 && x < 8 && y >= 0 && y < 8) {
+      if (boardManager.isOnBoard(x, y)) {
         IGamePiece *targetPiece = boardManager.getAtPosition(x, y);
         // If there is a piece at the target position, check if it belongs to the same team
         if (targetPiece != nullptr && targetPiece->isWhite == this->isWhite) {
@@ -240,6 +1022,8 @@ public:
         moves.push_back(Position(x, y));
       }
     }
+    for (auto &castle : boardManager.getCastlingMoves(this))
+      moves.push_back(castle);
     return moves;
   }
 };
@@ -261,6 +1045,15 @@ public:
     return isWhite ? KNIGHT : BK_KNIGHT; // Using ASCII for display
   }
 
+  // Override getLetter to return the setup letter of a Knight
+  char getLetter() override { return 'n'; }
+
+  // Override getDefinition to return the compiled Knight table
+  const PieceDefinition *getDefinition() override { return &knightDefinition; }
+
+  // Override getValue to return the material value of a Knight
+  int getValue() override { return 3; }
+
   // Override getPotentialMoves to return possible moves for a Knight
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
@@ -276,7 +1069,7 @@ public:
       Position newPos(position.x + move[0], position.y + move[1]);
       
       // Ensure the new position is within bounds of the chessboard
-      if (newPos.x >= 0 && newPos.x < 8 && newPos.y >= 0 && newPos.y < 8) {
+      if (boardManager.isOnBoard(newPos.x, newPos.y)) {
         IGamePiece *pieceAtTarget = boardManager.getAtPosition(newPos.x, newPos.y);
         
         // If the target position is empty or occupied by an opponent's piece, add the move
@@ -287,13 +1080,20 @@ public:
     }
     return moves;
   }
+
+  // Override generateMoves to append from the compiled Knight table without allocating
+  void generateMoves(std::vector<Position> &moves) override { walkCompiledRays(knightDefinition, this, moves, false); }
+
+  // Override getAttacks to add the squares of defended pieces, which getPotentialMoves leaves out
+  std::vector<Position> getAttacks() override { return walkMovements(knightDefinition, this, true); }
+
+  // Override generateAttacks to append from the compiled Knight table without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(knightDefinition, this, attacks, true); }
 };
 
 // The piece implements the "first-move" rule (WIP)
 class Pawn : public IGamePiece {
 public:
-  bool hasMoved = false; // Track if the pawn has moved
-
   Pawn(bool isWhite, int x, int y) {
     this->isWhite = isWhite;
     this->position = Position(x, y);
@@ -309,29 +1109,40 @@ public:
     return isWhite ? PAWN : BK_PAWN; // Using ASCII for display
   }
 
+  // Override getLetter to return the setup letter of a Pawn
+  char getLetter() override { return 'p'; }
+
+  // Override getDefinition to return the compiled Pawn table
+  const PieceDefinition *getDefinition() override { return &pawnDefinition; }
+
+  // Override getValue to return the material value of a Pawn
+  int getValue() override { return 1; }
+
   // Override getPotentialMoves to return possible moves for a Pawn
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
     
   // Define possible move directions based on color
   int direction = isWhite ? -1 : 1;  // White moves up (y - 1), Black moves down (y + 1)
-  int startRow = isWhite ? 6 : 1;  // White pawns start at row 6, Black pawns start at row 1
+  int startRow = isWhite ? boardManager.getHeight() - 2 : 1;  // White pawns start on the second to last row, Black pawns start at row 1
   
   // Move one square forward
   int forwardX = position.x;
   int forwardY = position.y + direction;
-  if (forwardY >= 0 && forwardY < 8) {
+  bool forwardIsEmpty = false;
+  if (boardManager.isOnBoard(forwardX, forwardY)) {
     IGamePiece *targetPiece = boardManager.getAtPosition(forwardX, forwardY);
     // Only move if the target is empty
     if (targetPiece == nullptr) {
+      forwardIsEmpty = true;
       moves.push_back(Position(forwardX, forwardY));
     }
   }
 
-  // If the pawn hasn't moved yet, allow moving two squares forward
-  if (!hasMoved) {
+  // If the pawn hasn't moved yet, allow moving two squares forward (only if the square in between is empty)
+  if (!hasMoved && position.y == startRow && forwardIsEmpty) {
     int doubleForwardY = position.y + 2 * direction;
-    if (doubleForwardY >= 0 && doubleForwardY < 8) {
+    if (boardManager.isOnBoard(forwardX, doubleForwardY)) {
       IGamePiece *targetPiece = boardManager.getAtPosition(forwardX, doubleForwardY);
       if (targetPiece == nullptr) {
         moves.push_back(Position(forwardX, doubleForwardY));
@@ -343,7 +1154,7 @@ public:
   int captureX[2] = { position.x + 1, position.x - 1 };  // Capture diagonally to the right or left
   for (int i = 0; i < 2; ++i) {
     int captureY = position.y + direction;  // Captures go in the same direction as forward movement
-    if (captureX[i] >= 0 && captureX[i] < 8 && captureY >= 0 && captureY < 8) {
+    if (boardManager.isOnBoard(captureX[i], captureY)) {
       IGamePiece *targetPiece = boardManager.getAtPosition(captureX[i], captureY);
       if (targetPiece != nullptr && targetPiece->isWhite != this->isWhite) {
         moves.push_back(Position(captureX[i], captureY));  // Capture if the target is an opponent's piece
@@ -353,10 +1164,32 @@ public:
     return moves;
   }
 
-  // After the pawn moves, update the hasMoved status
-  void movePiece() {
-    hasMoved = true;
+  // Override getAttacks to return both forward diagonals whatever stands on them, pawns never capture straight ahead
+  std::vector<Position> getAttacks() override {
+    std::vector<Position> attacks;
+    int direction = isWhite ? -1 : 1;
+    int captureX[2] = {position.x + 1, position.x - 1};
+    for (int i = 0; i < 2; ++i) {
+      if (boardManager.isOnBoard(captureX[i], position.y + direction))
+        attacks.push_back(Position(captureX[i], position.y + direction));
+    }
+    return attacks;
+  }
+
+  // Override generateMoves to append the table-driven step and captures plus the double step without allocating
+  void generateMoves(std::vector<Position> &moves) override {
+    walkCompiledRays(pawnDefinition, this, moves, false);
+    int direction = isWhite ? -1 : 1;
+    int startRow = isWhite ? boardManager.getHeight() - 2 : 1;
+    // the double step needs both squares ahead to be empty
+    if (!hasMoved && position.y == startRow && boardManager.isOnBoard(position.x, position.y + 2 * direction) &&
+        boardManager.getAtPosition(position.x, position.y + direction) == nullptr &&
+        boardManager.getAtPosition(position.x, position.y + 2 * direction) == nullptr)
+      moves.push_back(Position(position.x, position.y + 2 * direction));
   }
+
+  // Override generateAttacks to append the table-driven diagonals without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(pawnDefinition, this, attacks, true); }
 };
 
 class Rook : public IGamePiece {
@@ -376,6 +1209,15 @@ public:
     return isWhite ? ROOK : BK_ROOK; // Using ASCII for display
   }
 
+  // Override getLetter to return the setup letter of a Rook
+  char getLetter() override { return 'r'; }
+
+  // Override getDefinition to return the compiled Rook table
+  const PieceDefinition *getDefinition() override { return &rookDefinition; }
+
+  // Override getValue to return the material value of a Rook
+  int getValue() override { return 5; }
+
   // Override getPotentialMoves to return possible moves for a Rook
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
@@ -398,7 +1240,7 @@ public:
         y += direction[1];
 
         // Check if the new position is within bounds
-        if (x < 0 || x >= 8 || y < 0 || y >= 8) {
+        if (!boardManager.isOnBoard(x, y)) {
           break; // Stop if the move goes out of bounds
         }
 
@@ -420,6 +1262,15 @@ public:
     }
     return moves;
   }
+
+  // Override generateMoves to append from the compiled Rook table without allocating
+  void generateMoves(std::vector<Position> &moves) override { walkCompiledRays(rookDefinition, this, moves, false); }
+
+  // Override getAttacks to add the squares of defended pieces, which getPotentialMoves leaves out
+  std::vector<Position> getAttacks() override { return walkMovements(rookDefinition, this, true); }
+
+  // Override generateAttacks to append from the compiled Rook table without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(rookDefinition, this, attacks, true); }
 };
 
 class Bishop : public IGamePiece {
@@ -439,6 +1290,15 @@ public:
     return isWhite ? BISHOP : BK_BISHOP; // Using ASCII for display
   }
 
+  // Override getLetter to return the setup letter of a Bishop
+  char getLetter() override { return 'b'; }
+
+  // Override getDefinition to return the compiled Bishop table
+  const PieceDefinition *getDefinition() override { return &bishopDefinition; }
+
+  // Override getValue to return the material value of a Bishop
+  int getValue() override { return 3; }
+
   // Override getPotentialMoves to return possible moves for a Bishop
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
@@ -461,7 +1321,7 @@ public:
         y += direction[1];
 
         // Check if the new position is within bounds
-        if (x < 0 || x >= 8 || y < 0 || y >= 8) {
+        if (!boardManager.isOnBoard(x, y)) {
           break; // Stop if the move goes out of bounds
         }
 
@@ -483,6 +1343,15 @@ public:
     }
     return moves;
   }
+
+  // Override generateMoves to append from the compiled Bishop table without allocating
+  void generateMoves(std::vector<Position> &moves) override { walkCompiledRays(bishopDefinition, this, moves, false); }
+
+  // Override getAttacks to add the squares of defended pieces, which getPotentialMoves leaves out
+  std::vector<Position> getAttacks() override { return walkMovements(bishopDefinition, this, true); }
+
+  // Override generateAttacks to append from the compiled Bishop table without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(bishopDefinition, this, attacks, true); }
 };
 
 // Combined Rook and Bishop moves
@@ -503,6 +1372,15 @@ public:
     return isWhite ? QUEEN : BK_QUEEN; // Using ASCII for display
   }
 
+  // Override getLetter to return the setup letter of a Queen
+  char getLetter() override { return 'q'; }
+
+  // Override getDefinition to return the compiled Queen table
+  const PieceDefinition *getDefinition() override { return &queenDefinition; }
+
+  // Override getValue to return the material value of a Queen
+  int getValue() override { return 9; }
+
   // Override getPotentialMoves to return possible moves for a Queen
   std::vector<Position> getPotentialMoves() override {
     std::vector<Position> moves;
@@ -530,7 +1408,7 @@ public:
         y += direction[1];
 
         // Check if the new position is within bounds
-        if (x < 0 || x >= 8 || y < 0 || y >= 8) {
+        if (!boardManager.isOnBoard(x, y)) {
           break; // Stop if the move goes out of bounds
         }
 
@@ -552,46 +1430,903 @@ public:
     }
     return moves;
   }
+
+  // Override generateMoves to append from the compiled Queen table without allocating
+  void generateMoves(std::vector<Position> &moves) override { walkCompiledRays(queenDefinition, this, moves, false); }
+
+  // Override getAttacks to add the squares of defended pieces, which getPotentialMoves leaves out
+  std::vector<Position> getAttacks() override { return walkMovements(queenDefinition, this, true); }
+
+  // Override generateAttacks to append from the compiled Queen table without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(queenDefinition, this, attacks, true); }
+};
+
+// pieceDefinitions holds every custom piece that createPiece can place on the board
+// the Capablanca pieces are built in, more can be loaded with loadPieceDefinitions
+// a deque keeps pointers held by FairyPiece valid while definitions are added
+static std::deque<PieceDefinition> pieceDefinitions = {
+    {'a', "Archbishop", 7, "a ", "A ", {{PieceMovement::Ride, Position(1, 1)}, {PieceMovement::Leap, Position(1, 2)}}},
+    {'c', "Chancellor", 8, "c ", "C ", {{PieceMovement::Ride, Position(1, 0)}, {PieceMovement::Leap, Position(1, 2)}}},
+};
+
+// FairyPiece is a piece whose moves come from a compiled PieceDefinition
+class FairyPiece : public IGamePiece {
+public:
+  const PieceDefinition *definition;
+
+  FairyPiece(const PieceDefinition *definition, bool isWhite, int x, int y) {
+    this->definition = definition;
+    this->isWhite = isWhite;
+    this->position = Position(x, y);
+  }
+
+  // Override getName to return the name of the piece
+  std::string getName() override {
+    std::string color = isWhite ? "White " : "Black ";
+    return color + definition->name;
+  }
+
+  // Override render to return a representation of the piece
+  std::string render() override {
+    return isWhite ? definition->whiteSymbol : definition->blackSymbol;
+  }
+
+  // Override getValue to return the material value from the definition
+  int getValue() override { return definition->value; }
+
+  // Override getLetter to return the setup letter from the definition
+  char getLetter() override { return definition->letter; }
+
+  // Override getDefinition to return the compiled table of the custom piece
+  const PieceDefinition *getDefinition() override { return definition; }
+
+  // Override getPotentialMoves to walk the movement offsets directly, the reference for generateMoves
+  std::vector<Position> getPotentialMoves() override { return walkMovements(*definition, this, false); }
+
+  // Override generateMoves to append straight from the compiled rays without allocating
+  void generateMoves(std::vector<Position> &moves) override { walkCompiledRays(*definition, this, moves, false); }
+
+  // Override getAttacks to return every square a capturing movement reaches, whether or not an enemy stands there
+  // walks the movement offsets directly, the reference for generateAttacks
+  std::vector<Position> getAttacks() override { return walkMovements(*definition, this, true); }
+
+  // Override generateAttacks to append straight from the compiled rays without allocating
+  void generateAttacks(std::vector<Position> &attacks) override { walkCompiledRays(*definition, this, attacks, true); }
+
 };
 
+// loadPieceDefinitions adds custom pieces from a text file, one piece per line:
+//   <letter> <name> <value> <white symbol> <black symbol> <movement>...
+// where each movement is `leap:dx,dy`, `ride:dx,dy` or `hop:dx,dy` with optional flags after a slash:
+//   m = move only, c = capture only, f = only the offset as written (from white's side) instead of all 8 symmetries
+// e.g. `g Grasshopper 2 g G hop:1,0 hop:1,1` or `s Sergeant 1 s S leap:0,-1/fm leap:1,-1/fc leap:-1,-1/fc`
+// the letter must be a-z (it doubles as the pocket index in crazyhouse)
+// blank lines and lines starting with '#' are ignored, errors are reported on std::cerr and return false
+bool loadPieceDefinitions(const char *path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Could not open piece definitions: " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    std::istringstream fields(line);
+    PieceDefinition definition;
+    std::string letter;
+    if (!(fields >> letter) || letter[0] == '#')
+      continue;
+    if (!(fields >> definition.name >> definition.value >> definition.whiteSymbol >> definition.blackSymbol) || letter.size() != 1) {
+      std::cerr << path << ":" << lineNumber << ": expected <letter> <name> <value> <white symbol> <black symbol>" << std::endl;
+      return false;
+    }
+    if (!std::isalpha((unsigned char)letter[0])) {
+      std::cerr << path << ":" << lineNumber << ": piece letter '" << letter << "' is not a letter" << std::endl;
+      return false;
+    }
+    definition.letter = std::tolower(letter[0]);
+    if (std::string("kqrbnp").find(definition.letter) != std::string::npos) {
+      std::cerr << path << ":" << lineNumber << ": letter '" << definition.letter << "' is used by a standard piece" << std::endl;
+      return false;
+    }
+    definition.whiteSymbol += " "; // pad symbols to two columns like the standard pieces
+    definition.blackSymbol += " ";
+    std::string token;
+    while (fields >> token) {
+      PieceMovement movement;
+      char kind[8] = {};
+      int consumed = 0; // characters read by sscanf, everything after them must be empty or `/flags`
+      int matched = std::sscanf(token.c_str(), "%7[a-z]:%d,%d%n", kind, &movement.offset.x, &movement.offset.y, &consumed);
+      std::string kindName = kind;
+      std::string rest = matched < 3 ? "" : token.substr(consumed);
+      if (matched < 3 || (!rest.empty() && rest[0] != '/') || (movement.offset.x == 0 && movement.offset.y == 0) ||
+          (kindName != "leap" && kindName != "ride" && kindName != "hop")) {
+        std::cerr << path << ":" << lineNumber << ": bad movement '" << token << "'" << std::endl;
+        return false;
+      }
+      movement.kind = kindName == "leap" ? PieceMovement::Leap : kindName == "ride" ? PieceMovement::Ride : PieceMovement::Hop;
+      for (size_t i = 1; i < rest.size(); i++) { // rest[0] is the slash
+        char flag = rest[i];
+        if (flag == 'm')
+          movement.canCapture = false;
+        else if (flag == 'c')
+          movement.canMove = false;
+        else if (flag == 'f')
+          movement.symmetric = false;
+        else {
+          std::cerr << path << ":" << lineNumber << ": unknown flag '" << flag << "' in movement '" << token << "'" << std::endl;
+          return false;
+        }
+      }
+      definition.movements.push_back(movement);
+    }
+    // a later definition with the same letter replaces the earlier one
+    auto existing = std::find_if(pieceDefinitions.begin(), pieceDefinitions.end(),
+                                 [&](const PieceDefinition &other) { return other.letter == definition.letter; });
+    if (existing != pieceDefinitions.end())
+      *existing = definition;
+    else
+      pieceDefinitions.push_back(definition);
+  }
+  return true;
+}
+
+// createPiece returns a new piece for a setup letter (k, q, r, b, n, p or a custom piece letter) or nullptr for an empty square
+IGamePiece *createPiece(char letter, bool isWhite, int x, int y) {
+  switch (letter) {
+  case 'k':
+    return new King(isWhite, x, y);
+  case 'q':
+    return new Queen(isWhite, x, y);
+  case 'r':
+    return new Rook(isWhite, x, y);
+  case 'b':
+    return new Bishop(isWhite, x, y);
+  case 'n':
+    return new Knight(isWhite, x, y);
+  case 'p':
+    return new Pawn(isWhite, x, y);
+  }
+  for (auto &definition : pieceDefinitions) {
+    if (definition.letter == letter)
+      return new FairyPiece(&definition, isWhite, x, y);
+  }
+  return nullptr;
+}
+
 // Implement prepareBoard *after* declaring all pieces so they can be referenced here and placed on the board
-void BoardManager::prepareBoard() {
-  // create an 8x8 chessboard defaulting to null pointers of IGamePiece objects
-  board = std::vector<std::vector<IGamePiece *>>(8, std::vector<IGamePiece *>(8, nullptr));
+void BoardManager::prepareBoard(const std::string &backRank, int height) {
+  // delete the pieces of a previous game and empty the pockets
+  for (auto &column : board) {
+    for (IGamePiece *piece : column)
+      delete piece;
+  }
+  int width = backRank.size();
+  for (auto &sidePockets : pockets) {
+    for (auto &pocket : sidePockets) {
+      for (IGamePiece *piece : pocket)
+        delete piece;
+      pocket.clear();
+      pocket.reserve(width * 4); // room for every piece on the board, so pocketing a capture never allocates
+    }
+  }
+  pocketValue[0] = pocketValue[1] = 0;
+  attackBuffer.reserve(256);
+  // create a width x height chessboard defaulting to null pointers of IGamePiece objects
+  board = std::vector<std::vector<IGamePiece *>>(width, std::vector<IGamePiece *>(height, nullptr));
+  // piece tables depend on the board size
+  for (PieceDefinition *definition : {&kingDefinition, &knightDefinition, &bishopDefinition, &rookDefinition, &queenDefinition, &pawnDefinition})
+    definition->compile(width, height);
+  for (auto &definition : pieceDefinitions)
+    definition.compile(width, height);
   // [column][row]
-  // Row 0 (Black pieces)
-  board[0][0] = new Rook(false, 0, 0); // Black Rook
-  board[1][0] = new Knight(false, 1, 0); // Black Knight
-  board[2][0] = new Bishop(false, 2, 0); // Black Bishop
-  board[3][0] = new Queen(false, 3, 0); // Black Queen
-  board[4][0] = new King(false, 4, 0); // Black King
-  board[5][0] = new Bishop(false, 5, 0); // Black Bishop
-  board[6][0] = new Knight(false, 6, 0); // Black Knight
-  board[7][0] = new Rook(false, 7, 0); // Black Rook
-
-  // Row 1 (Black Pawns)
-  for (int i = 0; i < 8; i++) {
-    board[i][1] = new Pawn(false, i, 1);
-  }
-
-  // Row 6 (White Pawns)
-  for (int i = 0; i < 8; i++) {
-    board[i][6] = new Pawn(true, i, 6);
-  }
-
-  // Row 7 (White Pieces)
-  board[0][7] = new Rook(true, 0, 7);
-  board[1][7] = new Knight(true, 1, 7);
-  board[2][7] = new Bishop(true, 2, 7);
-  board[3][7] = new Queen(true, 3, 7);
-  board[4][7] = new King(true, 4, 7);
-  board[5][7] = new Bishop(true, 5, 7);
-  board[6][7] = new Knight(true, 6, 7);
-  board[7][7] = new Rook(true, 7, 7);
+  for (int i = 0; i < width; i++) {
+    board[i][0] = createPiece(backRank[i], false, i, 0);                   // Row 0 (Black pieces)
+    board[i][1] = new Pawn(false, i, 1);                                   // Row 1 (Black Pawns)
+    board[i][height - 2] = new Pawn(true, i, height - 2);                  // second to last row (White Pawns)
+    board[i][height - 1] = createPiece(backRank[i], true, i, height - 1); // last row (White Pieces)
+  }
+  // the king may castle with the outermost rook on each side of it
+  castlingRights.clear();
+  int kingX = backRank.find('k');
+  int queenSideRookX = backRank.find('r');
+  int kingSideRookX = backRank.rfind('r');
+  if (kingX != (int)std::string::npos) {
+    for (int row : {0, height - 1}) {
+      if (queenSideRookX != (int)std::string::npos && queenSideRookX < kingX)
+        addCastlingRight(kingX, queenSideRookX, row);
+      if (kingSideRookX != (int)std::string::npos && kingSideRookX > kingX)
+        addCastlingRight(kingX, kingSideRookX, row);
+    }
+  }
+  if (trackAttacks)
+    attackMap = computeAttackMap();
+}
+
+// perft is implemented here so the generateMoves overrides of every piece are declared
+unsigned long long BoardManager::perft(int depth, bool whiteToMove, std::vector<std::vector<Position>> &buffers) {
+  if (depth == 0)
+    return 1;
+  unsigned long long nodes = 0;
+  std::vector<Position> &moves = buffers[depth - 1]; // deeper plies use lower buffers, so this one stays intact
+  for (int x = 0; x < getWidth(); x++) {
+    for (int y = 0; y < getHeight(); y++) {
+      IGamePiece *piece = board[x][y];
+      if (piece == nullptr || piece->isWhite != whiteToMove)
+        continue;
+      moves.clear();
+      piece->generateMoves(moves);
+      if (depth == 1) { // the moves themselves are the leaves, no need to play them
+        nodes += moves.size();
+        continue;
+      }
+      for (auto &move : moves) {
+        MoveUndo undo = makeMove(piece, move);
+        nodes += perft(depth - 1, !whiteToMove, buffers);
+        unmakeMove(undo);
+      }
+    }
+  }
+  if (!crazyhouse)
+    return nodes;
+  for (char letter = 'a'; letter <= 'z'; letter++) {
+    if (pockets[whiteToMove][letter - 'a'].empty())
+      continue;
+    moves.clear();
+    appendDropSquares(letter, moves);
+    if (depth == 1) {
+      nodes += moves.size();
+      continue;
+    }
+    for (auto &square : moves) {
+      MoveUndo undo = makeDrop(letter, whiteToMove, square);
+      nodes += perft(depth - 1, !whiteToMove, buffers);
+      unmakeMove(undo);
+    }
+  }
+  return nodes;
+}
+
+// chess960BackRank returns the back rank of Chess960 start position `index` (0-959, 518 is the standard setup)
+// using the standard numbering: bishops, then queen, then knights, with rook king rook on the remaining squares
+std::string chess960BackRank(int index) {
+  std::string backRank = "........";
+  backRank[(index % 4) * 2 + 1] = 'b'; // light-squared bishop on b, d, f or h
+  index /= 4;
+  backRank[(index % 4) * 2] = 'b'; // dark-squared bishop on a, c, e or g
+  index /= 4;
+  // placeInEmpty puts `letter` on the n-th empty square counted from the left
+  auto placeInEmpty = [&](int n, char letter) {
+    for (auto &square : backRank) {
+      if (square == '.' && n-- == 0) {
+        square = letter;
+        return;
+      }
+    }
+  };
+  placeInEmpty(index % 6, 'q');
+  index /= 6;
+  // the 10 ways to put two knights on the 5 remaining squares
+  int knights[10][2] = {{0, 1}, {0, 2}, {0, 3}, {0, 4}, {1, 2}, {1, 3}, {1, 4}, {2, 3}, {2, 4}, {3, 4}};
+  placeInEmpty(knights[index][1], 'n'); // place the right knight first so the left index still counts the same squares
+  placeInEmpty(knights[index][0], 'n');
+  placeInEmpty(0, 'r');
+  placeInEmpty(0, 'k');
+  placeInEmpty(0, 'r');
+  return backRank;
+}
+
+// TraceRecorder keeps the most recent timed events in a fixed-size ring buffer and writes them as Chrome trace JSON
+// (open the file in chrome://tracing or https://ui.perfetto.dev), recording is off unless --trace is given
+class TraceRecorder {
+public:
+  bool enabled = false;
+
+  // record stores one finished event, `name` must be a string literal because only the pointer is kept
+  void record(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (!enabled)
+      return;
+    // the buffer never grows, once full the oldest event is overwritten
+    events[count % CAPACITY] = {name, std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count(),
+                                std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()};
+    count++;
+  }
+
+  // write saves the recorded events, oldest first, as a Chrome trace event file
+  // returns false if the file could not be written
+  bool write(const char *path) {
+    std::ofstream file(path);
+    if (!file)
+      return false;
+    file << "{\"traceEvents\":[";
+    size_t first = count > CAPACITY ? count - CAPACITY : 0;
+    for (size_t i = first; i < count; i++) {
+      const TraceEvent &event = events[i % CAPACITY];
+      file << (i == first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":" << event.start
+           << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":1}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return bool(file);
+  }
+
+private:
+  static const size_t CAPACITY = 4096;
+  struct TraceEvent {
+    const char *name;
+    long long start;    // microseconds since the recorder was created
+    long long duration; // microseconds
+  };
+  TraceEvent events[CAPACITY];
+  size_t count = 0; // total events recorded, including overwritten ones
+  std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+// declare a global tracer so any function can add events without passing it around
+static TraceRecorder tracer;
+
+// TraceScope records the time from its construction to the end of the enclosing scope as one event
+struct TraceScope {
+  const char *name;
+  std::chrono::steady_clock::time_point start;
+  TraceScope(const char *name) : name(name) {
+    if (tracer.enabled) // skip the clock read entirely when tracing is off
+      start = std::chrono::steady_clock::now();
+  }
+  ~TraceScope() {
+    if (tracer.enabled)
+      tracer.record(name, start, std::chrono::steady_clock::now());
+  }
+};
+
+// UIState holds everything the interaction loop needs between keystrokes
+struct UIState {
+  Position cursor = Position(0, 0);     // start cursor in top left corner
+  IGamePiece *selectedPiece = nullptr;  // reference to the currently selected gamePiece, start deselected
+  std::vector<Position> moves;          // vector of potential moves for the selectedPiece
+  std::string status = "";              // status text printed below the board
+  bool showAnalysis = true;             // draw threatened pieces and the material bar, toggled with 'a'
+  char dropLetter = 0;                  // setup letter of the pocketed piece chosen with 'd', 0 when not dropping
+  bool dropWhite = false;               // color of the pocketed piece chosen with 'd'
+};
+
+// selectNextDrop cycles `state` to the next pocketed piece (white pockets first, then black)
+// and returns false once every pocket has been cycled through
+bool selectNextDrop(UIState &state) {
+  // index 0-25 are white letters a-z, 26-51 are black letters a-z, the current choice is skipped
+  int current = state.dropLetter == 0 ? -1 : (state.dropWhite ? 0 : 26) + (state.dropLetter - 'a');
+  for (int index = current + 1; index < 52; index++) {
+    bool isWhite = index < 26;
+    char letter = 'a' + index % 26;
+    if (boardManager.getPocketCount(letter, isWhite) > 0) {
+      state.dropLetter = letter;
+      state.dropWhite = isWhite;
+      return true;
+    }
+  }
+  state.dropLetter = 0;
+  return false;
+}
+
+// processKey reads one keystroke (including any trailing escape sequence) from `input` and applies it to `state`
+// returns false when the user asked to quit
+bool processKey(UIState &state, std::istream &input) {
+  state.status = "";     // reset status text after any interaction
+  char c = input.get(); // wait for keyboard input
+  if (!input)           // treat end of input (only possible in replay mode) like a quit
+    return false;
+  TraceScope trace("processKey"); // started after the key arrives so waiting for the user is not counted
+  // process user input
+  if (c == '\033') { // if control characterwas pressed, we need to capture the following control characters and process them
+    char seq1 = input.get();
+    char seq2 = input.get();
+    if (seq1 == '[') { // control character may be an arrow if sequence starts with `\033[`
+      switch (seq2) {  // if arrow key was pressed, move cursor around the board
+      case 'A':        // up arrow
+        state.cursor.y = std::clamp(state.cursor.y - 1, 0, boardManager.getHeight() - 1);
+        break;
+      case 'B': // down arrow
+        state.cursor.y = std::clamp(state.cursor.y + 1, 0, boardManager.getHeight() - 1);
+        break;
+      case 'C': // right arrow
+        state.cursor.x = std::clamp(state.cursor.x + 1, 0, boardManager.getWidth() - 1);
+        break;
+      case 'D': // left arrow
+        state.cursor.x = std::clamp(state.cursor.x - 1, 0, boardManager.getWidth() - 1);
+        break;
+      }
+      if (state.selectedPiece != nullptr) // if a piece is currently selected, add its name to the status message
+        state.status += state.selectedPiece->getName() + " selected";
+    }
+  } else if (c == 'q' || c == 3) { // quit on 'q' or ctrl+c
+    return false;
+  } else if (c == 'a') { // toggle the analysis overlay
+    state.showAnalysis = !state.showAnalysis;
+    state.status += state.showAnalysis ? "Analysis on" : "Analysis off";
+  } else if (c == 'd' && boardManager.crazyhouse) { // choose the next pocketed piece to drop
+    state.selectedPiece = nullptr;
+    if (selectNextDrop(state)) {
+      state.moves = boardManager.getDropSquares(state.dropLetter);
+      state.status += std::string("Dropping ") + (state.dropWhite ? "white " : "black ") + state.dropLetter;
+    } else {
+      state.moves = std::vector<Position>();
+      state.status += "Nothing to drop";
+    }
+  } else if (c == ' ') {  // "select" (space or return key pressed)
+    if (state.dropLetter != 0) { // if a pocketed piece is chosen, attempt to drop it on the cursor
+      if (boardManager.dropPiece(state.dropLetter, state.dropWhite, state.cursor))
+        state.status += std::string("Dropped ") + (state.dropWhite ? "white " : "black ") + state.dropLetter;
+      else
+        state.status += "Drop cancelled";
+      state.dropLetter = 0;
+      state.moves = std::vector<Position>();
+    } else if (state.selectedPiece != nullptr) {                     // if a piece is currently selected
+      if (boardManager.movePiece(state.selectedPiece, state.cursor)) // attempt move if a potential move position is selected
+        state.status += "Moved " + state.selectedPiece->getName();
+      else
+        state.status += "Deselected";
+      state.selectedPiece = nullptr; // clear the selectedPiece and the potential moves list after any selection is made
+      state.moves = std::vector<Position>();
+    } else {                                                                     // if a piece is not currently selected
+      if (boardManager.getAtPosition(state.cursor.x, state.cursor.y) == nullptr) { // do nothing but update status message if an empty space is selected
+        state.status += "Empty space selected";
+      } else { // set the selectedPiece reference and update the potentialmoves list for the piece
+        state.selectedPiece = boardManager.getAtPosition(state.cursor.x, state.cursor.y);
+        state.moves = state.selectedPiece->getPotentialMoves();
+        state.status += state.selectedPiece->getName() + " selected";
+      }
+    }
+  }
+  return true;
+}
+
+// renderMaterialBar prints a bar that fills towards the side that is ahead in material
+void renderMaterialBar(int balance, std::ostream &out) {
+  const int halfWidth = 10; // one cell per pawn of advantage, capped at 10 pawns either way
+  int filled = std::clamp(balance, -halfWidth, halfWidth);
+  out << "Black ";
+  for (int i = -halfWidth; i < halfWidth; i++) {
+    // cells between the center and the fill level take the color of the side that is ahead
+    bool lit = (filled < 0 && i >= filled && i < 0) || (filled > 0 && i >= 0 && i < filled);
+    out << (lit ? (filled > 0 ? BG_WHITE : BG_RED) : BG_BLACK) << (i == 0 ? '|' : ' ');
+  }
+  out << CLEAR << BG_BLACK << " White (" << (balance > 0 ? "+" : "") << balance << ")\r" << std::endl;
+}
+
+// renderFrame clears the screen and draws the help text, the board and the status message
+void renderFrame(const UIState &state, std::ostream &out) {
+  TraceScope trace("renderFrame");
+  out << BG_BLACK << RESET;                                         // Clear screen and use dark background
+  out << "Controls: Arrow Keys, Space to Select, 'a' for Analysis"; // print help text at top
+  if (boardManager.crazyhouse)
+    out << ", 'd' to Drop";
+  out << " ('q' to quit)\n\r";
+  std::vector<Position> threats;
+  BoardManager::AttackMap attackMap;
+  if (state.showAnalysis) {
+    TraceScope traceAnalysis("computeAttackMap");
+    // with --track-attacks the map is already current, otherwise it is rebuilt for this frame
+    attackMap = boardManager.isTrackingAttacks() ? boardManager.getAttackMap() : boardManager.computeAttackMap();
+    threats = boardManager.getThreatenedSquares(attackMap);
+  }
+  {
+    TraceScope traceBoard("renderBoard");
+    boardManager.renderBoard(state.cursor, state.selectedPiece, state.moves, threats, out);
+  }
+  if (state.showAnalysis) {
+    renderMaterialBar(boardManager.getMaterialBalance(), out);
+    int hanging[2] = {}; // threatened pieces that no piece of their own side defends
+    for (auto &threat : threats) {
+      if (boardManager.isHanging(attackMap, threat))
+        hanging[boardManager.getAtPosition(threat.x, threat.y)->isWhite]++;
+    }
+    out << "Mobility: White " << attackMap.mobility[true] << ", Black " << attackMap.mobility[false]
+        << " | King zone attacked: White " << attackMap.kingZoneAttacks[true] << ", Black " << attackMap.kingZoneAttacks[false]
+        << " | Hanging: White " << hanging[true] << ", Black " << hanging[false] << "\r" << std::endl;
+  }
+  if (boardManager.crazyhouse) { // list each pocket as count and letter, e.g. "2p 1n"
+    for (bool isWhite : {true, false}) {
+      out << (isWhite ? "White pocket:" : "Black pocket:");
+      for (char letter = 'a'; letter <= 'z'; letter++) {
+        if (boardManager.getPocketCount(letter, isWhite) > 0)
+          out << ' ' << boardManager.getPocketCount(letter, isWhite) << letter;
+      }
+      out << "\r" << std::endl;
+    }
+  }
+  out << state.status;
+}
+
+// runReplay feeds a recorded keystroke script through processKey/renderFrame without a terminal
+// every frame is rendered into memory and the per-keystroke timings and output sizes are reported on stdout
+// the script is the raw byte stream a terminal would send, e.g. `printf ' \033[B \033[A' > script.keys`
+// the board must already be prepared
+int runReplay(const char *scriptPath) {
+  std::ifstream script(scriptPath, std::ios::binary);
+  if (!script) {
+    std::cerr << "Could not open replay script: " << scriptPath << std::endl;
+    return 1;
+  }
+  using Clock = std::chrono::steady_clock;
+  std::vector<double> processTimes; // microseconds spent in processKey for each keystroke
+  std::vector<double> renderTimes;  // microseconds spent in renderFrame for each keystroke
+  std::vector<size_t> frameBytes;   // bytes written by renderFrame for each keystroke
+
+  UIState state;
+  std::ostringstream sink;
+  renderFrame(state, sink); // initial frame, not counted as a keystroke
+  while (true) {
+    auto start = Clock::now();
+    bool running = processKey(state, script);
+    auto processed = Clock::now();
+    if (!running)
+      break;
+    sink.str("");
+    renderFrame(state, sink);
+    auto rendered = Clock::now();
+    processTimes.push_back(std::chrono::duration<double, std::micro>(processed - start).count());
+    renderTimes.push_back(std::chrono::duration<double, std::micro>(rendered - processed).count());
+    frameBytes.push_back(sink.str().size());
+  }
+
+  // prints count, mean, median, 99th percentile and max for a list of samples
+  auto report = [](const char *label, std::vector<double> samples) {
+    if (samples.empty())
+      return;
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double sample : samples)
+      total += sample;
+    std::cout << label << ": mean " << total / samples.size() << " us, p50 " << samples[samples.size() / 2]
+              << " us, p99 " << samples[(samples.size() * 99) / 100] << " us, max " << samples.back() << " us\n";
+  };
+  size_t totalBytes = 0;
+  size_t maxBytes = 0;
+  for (size_t bytes : frameBytes) {
+    totalBytes += bytes;
+    maxBytes = std::max(maxBytes, bytes);
+  }
+  std::cout << "keystrokes: " << frameBytes.size() << "\n";
+  report("process", processTimes);
+  report("render", renderTimes);
+  std::cout << "bytes written: " << totalBytes << " total, "
+            << (frameBytes.empty() ? 0 : totalBytes / frameBytes.size()) << " per frame, " << maxBytes << " max\n";
+  return 0;
+}
+
+// runPerft prints perft node counts and speed for every depth up to `maxDepth` on the prepared board
+// the walk runs inside an AllocationGuard, so an ALLOC_GUARD build stops at the first allocation in move generation
+int runPerft(int maxDepth) {
+  std::vector<std::vector<Position>> buffers(maxDepth);
+  for (auto &buffer : buffers) // more than any single piece or drop can have, so generateMoves never grows a buffer
+    buffer.reserve(std::max(256, boardManager.getWidth() * boardManager.getHeight()));
+  for (int depth = 1; depth <= maxDepth; depth++) {
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long nodes;
+    {
+      [[maybe_unused]] AllocationGuard guard;
+      nodes = boardManager.perft(depth, true, buffers);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "perft " << depth << ": " << nodes << " nodes, " << seconds * 1000 << " ms, "
+              << (seconds > 0 ? nodes / seconds / 1e6 : 0) << " Mnps\n";
+  }
+  return 0;
+}
+
+// runDiffTest plays `games` random games from the given setup and checks at every ply that
+// - every piece's generateMoves/generateAttacks return the same squares as the getPotentialMoves/getAttacks reference
+// - in crazyhouse, appendDropSquares returns the same squares as getDropSquares for every pocketed piece
+// - in crazyhouse, a king recaptures its own rook after the enemy captured and dropped it (see checkRookRecapture)
+// - makeMove (or makeDrop) followed by unmakeMove restores every square, piece position, hasMoved flag, pocket and the material balance
+// - with --track-attacks, the incrementally updated attack map equals a full rebuild
+// game g uses random seed g, the first mismatch is printed and makes it return 1
+int runDiffTest(int games, const std::string &backRank, int height) {
+  const int maxPlies = 200;
+  // sameSquares compares two move lists ignoring order
+  auto sameSquares = [](std::vector<Position> a, std::vector<Position> b) {
+    auto byCoordinates = [](const Position &l, const Position &r) { return l.x != r.x ? l.x < r.x : l.y < r.y; };
+    std::sort(a.begin(), a.end(), byCoordinates);
+    std::sort(b.begin(), b.end(), byCoordinates);
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](const Position &l, const Position &r) { return l.x == r.x && l.y == r.y; });
+  };
+  // printSquares writes a move list as "x,y x,y ..."
+  auto printSquares = [](const char *label, const std::vector<Position> &squares) {
+    std::cout << "  " << label << ":";
+    for (auto &square : squares)
+      std::cout << ' ' << square.x << ',' << square.y;
+    std::cout << "\n";
+  };
+  // snapshot records the piece, its stored position, color and hasMoved for every square
+  struct SquareState {
+    IGamePiece *piece;
+    int x, y;
+    bool isWhite;
+    bool hasMoved;
+  };
+  // the pocket counts are appended as extra entries, one per side and letter
+  auto snapshot = []() {
+    std::vector<SquareState> squares;
+    for (int x = 0; x < boardManager.getWidth(); x++) {
+      for (int y = 0; y < boardManager.getHeight(); y++) {
+        IGamePiece *piece = boardManager.getAtPosition(x, y);
+        squares.push_back(piece == nullptr ? SquareState{nullptr, 0, 0, false, false}
+                                           : SquareState{piece, piece->position.x, piece->position.y, piece->isWhite, piece->hasMoved});
+      }
+    }
+    for (bool isWhite : {true, false}) {
+      for (char letter = 'a'; letter <= 'z'; letter++)
+        squares.push_back(SquareState{nullptr, boardManager.getPocketCount(letter, isWhite), 0, false, false});
+    }
+    return squares;
+  };
+  // sameState compares two snapshots
+  auto sameState = [](const std::vector<SquareState> &a, const std::vector<SquareState> &b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const SquareState &l, const SquareState &r) {
+      return l.piece == r.piece && l.x == r.x && l.y == r.y && l.isWhite == r.isWhite && l.hasMoved == r.hasMoved;
+    });
+  };
+  // checkRookRecapture plays, for every rook, the crazyhouse line where the enemy captures it, drops it on an empty
+  // square and the rook's own king captures it there, then takes it all back
+  // the dropped rook is the same object the king's castling right refers to, and makeMove keeps castling rights
+  // (as perft does), so this catches the king "castling" with an enemy rook instead of capturing it
+  // makeMove does not check moves, so the line is played directly whatever stands in between
+  auto checkRookRecapture = [&](int game) {
+    std::vector<IGamePiece *> kings[2], rooks[2], pieces[2];
+    Position empty(-1, -1);
+    for (int x = 0; x < boardManager.getWidth(); x++) {
+      for (int y = 0; y < boardManager.getHeight(); y++) {
+        IGamePiece *piece = boardManager.getAtPosition(x, y);
+        if (piece == nullptr) {
+          if (empty.x < 0)
+            empty = Position(x, y);
+          continue;
+        }
+        pieces[piece->isWhite].push_back(piece);
+        if (piece->getLetter() == 'k')
+          kings[piece->isWhite].push_back(piece);
+        else if (piece->getLetter() == 'r')
+          rooks[piece->isWhite].push_back(piece);
+      }
+    }
+    for (bool isWhite : {true, false}) {
+      if (empty.x < 0 || kings[isWhite].empty())
+        continue;
+      for (IGamePiece *rook : rooks[isWhite]) {
+        IGamePiece *king = kings[isWhite][0];
+        std::vector<SquareState> before = snapshot();
+        BoardManager::MoveUndo takeRook = boardManager.makeMove(pieces[!isWhite][0], rook->position);
+        BoardManager::MoveUndo dropRook = boardManager.makeDrop('r', !isWhite, empty);
+        BoardManager::MoveUndo recapture = boardManager.makeMove(king, empty);
+        bool captured = recapture.captured == rook && recapture.rook == nullptr && boardManager.getAtPosition(empty.x, empty.y) == king;
+        boardManager.unmakeMove(recapture);
+        boardManager.unmakeMove(dropRook);
+        boardManager.unmakeMove(takeRook);
+        if (!captured || !sameState(before, snapshot())) {
+          std::cout << "difftest: game " << game << ": " << king->getName() << " did not "
+                    << (captured ? "restore the board after recapturing" : "capture") << " its dropped rook on " << empty.x
+                    << ',' << empty.y << "\n";
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  // Candidate is one move of the side to move, either a piece move or a drop
+  struct Candidate {
+    IGamePiece *piece; // the piece that moves, nullptr for a drop
+    Position target;
+    char dropLetter; // setup letter of the dropped piece, 0 for a piece move
+  };
+
+  long long plies = 0;
+  long long checks = 0;
+  std::vector<Position> fast;
+  for (int game = 0; game < games; game++) {
+    boardManager.prepareBoard(backRank, height);
+    if (boardManager.crazyhouse && !checkRookRecapture(game))
+      return 1;
+    std::mt19937 random(game);
+    bool whiteToMove = true;
+    for (int ply = 0; ply < maxPlies; ply++) {
+      std::vector<Candidate> candidates; // every move of the side to move
+      for (int x = 0; x < boardManager.getWidth(); x++) {
+        for (int y = 0; y < boardManager.getHeight(); y++) {
+          IGamePiece *piece = boardManager.getAtPosition(x, y);
+          if (piece == nullptr)
+            continue;
+          checks++;
+          fast.clear();
+          piece->generateAttacks(fast);
+          std::vector<Position> reference = piece->getAttacks();
+          bool attacksMatch = sameSquares(fast, reference);
+          if (attacksMatch) {
+            fast.clear();
+            piece->generateMoves(fast);
+            reference = piece->getPotentialMoves();
+          }
+          if (!attacksMatch || !sameSquares(fast, reference)) {
+            std::cout << "difftest: game " << game << " ply " << ply << ": " << piece->getName() << " at " << x << ',' << y
+                      << (attacksMatch ? " moves" : " attacks") << " differ\n";
+            printSquares("fast", fast);
+            printSquares("reference", reference);
+            return 1;
+          }
+          if (piece->isWhite == whiteToMove) {
+            for (auto &move : fast)
+              candidates.push_back({piece, move, 0});
+          }
+        }
+      }
+      for (char letter = 'a'; boardManager.crazyhouse && letter <= 'z'; letter++) {
+        if (boardManager.getPocketCount(letter, whiteToMove) == 0)
+          continue;
+        checks++;
+        fast.clear();
+        boardManager.appendDropSquares(letter, fast);
+        std::vector<Position> reference = boardManager.getDropSquares(letter);
+        if (!sameSquares(fast, reference)) {
+          std::cout << "difftest: game " << game << " ply " << ply << ": drop squares for " << letter << " differ\n";
+          printSquares("fast", fast);
+          printSquares("reference", reference);
+          return 1;
+        }
+        for (auto &square : fast)
+          candidates.push_back({nullptr, square, letter});
+      }
+      if (boardManager.isTrackingAttacks()) {
+        BoardManager::AttackMap tracked = boardManager.getAttackMap();
+        BoardManager::AttackMap rebuilt = boardManager.computeAttackMap();
+        if (tracked.counts[0] != rebuilt.counts[0] || tracked.counts[1] != rebuilt.counts[1] ||
+            tracked.mobility[0] != rebuilt.mobility[0] || tracked.mobility[1] != rebuilt.mobility[1]) {
+          std::cout << "difftest: game " << game << " ply " << ply << ": tracked attack map differs from a rebuild\n";
+          return 1;
+        }
+      }
+      if (candidates.empty())
+        break;
+      auto [piece, target, dropLetter] = candidates[random() % candidates.size()];
+      std::string moveName = piece != nullptr ? piece->getName() : std::string("drop of ") + dropLetter;
+
+      // play the move and take it back, the board must come back exactly as it was
+      std::vector<SquareState> before = snapshot();
+      int balance = boardManager.getMaterialBalance();
+      BoardManager::MoveUndo undo =
+          piece != nullptr ? boardManager.makeMove(piece, target) : boardManager.makeDrop(dropLetter, whiteToMove, target);
+      boardManager.unmakeMove(undo);
+      std::vector<SquareState> after = snapshot();
+      bool restored = boardManager.getMaterialBalance() == balance && sameState(before, after);
+      if (!restored) {
+        std::cout << "difftest: game " << game << " ply " << ply << ": unmakeMove did not restore the board after "
+                  << moveName << " to " << target.x << ',' << target.y << "\n";
+        return 1;
+      }
+
+      // now play it for real through the validated path, capturing a king ends the game
+      IGamePiece *captured = boardManager.getAtPosition(target.x, target.y);
+      bool kingCaptured = captured != nullptr && captured->isWhite != whiteToMove && captured->getLetter() == 'k';
+      bool played = piece != nullptr ? boardManager.movePiece(piece, target) : boardManager.dropPiece(dropLetter, whiteToMove, target);
+      if (!played) {
+        std::cout << "difftest: game " << game << " ply " << ply << ": " << (piece != nullptr ? "movePiece" : "dropPiece")
+                  << " rejected " << moveName << " to " << target.x << ',' << target.y << "\n";
+        return 1;
+      }
+      plies++;
+      if (kingCaptured)
+        break;
+      whiteToMove = !whiteToMove;
+    }
+  }
+  std::cout << "difftest: " << games << " games, " << plies << " plies, " << checks
+            << " piece checks, all generators match the reference\n";
+  return 0;
+}
+
+// parseNumber reads a whole command line value as an int
+// returns false if `text` is empty, has anything after the number (e.g. `8x`) or does not fit in an int
+bool parseNumber(const char *text, int &value) {
+  char *end = nullptr;
+  errno = 0;
+  long number = std::strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno == ERANGE || number < INT_MIN || number > INT_MAX)
+    return false;
+  value = (int)number;
+  return true;
 }
 
 // you shouldnt need to modify main(), but you are free to change it if you want
-int main() {
+int main(int argc, char **argv) {
+  // command line options:
+  //   --setup <letters>  back rank from left to right, e.g. `rnbqkbnr` (default) or a wider row for large boards
+  //   --height <rows>    number of rows on the board (default 8)
+  //   --960 <index>      use Chess960 start position `index` (0-959) as the back rank
+  //   --pieces <file>    load custom piece definitions (see loadPieceDefinitions), e.g. for `--setup rnabqkbcnr`
+  //   --crazyhouse       captured pieces go to the capturer's pocket and can be dropped with 'd'
+  //   --track-attacks    keep per-square attack counts updated on every move instead of rebuilding them
+  //   --replay <script>  run the headless replay driver instead of the interactive terminal UI
+  //   --trace <file>     record processKey/renderFrame timings and write them as Chrome trace JSON on exit
+  //   --perft <depth>    print move tree node counts from the start position (white moves first) and exit
+  //   --difftest <games> play random games checking the fast generators against the reference ones and exit
+  std::string backRank = "rnbqkbnr";
+  int height = 8;
+  const char *replayScript = nullptr;
+  const char *tracePath = nullptr;
+  int perftDepth = 0;
+  int diffTestGames = 0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--crazyhouse") == 0)
+      boardManager.crazyhouse = true;
+    else if (std::strcmp(argv[i], "--track-attacks") == 0)
+      boardManager.setAttackTracking(true);
+    else if (std::strcmp(argv[i], "--setup") == 0 && hasValue)
+      backRank = argv[++i];
+    else if (std::strcmp(argv[i], "--height") == 0 && hasValue) {
+      if (!parseNumber(argv[++i], height)) {
+        std::cerr << "--height needs a number of rows, got " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--960") == 0 && hasValue) {
+      int index = 0;
+      if (!parseNumber(argv[++i], index) || index < 0 || index > 959) {
+        std::cerr << "Chess960 positions are numbered 0 to 959" << std::endl;
+        return 1;
+      }
+      backRank = chess960BackRank(index);
+    } else if (std::strcmp(argv[i], "--replay") == 0 && hasValue)
+      replayScript = argv[++i];
+    else if (std::strcmp(argv[i], "--trace") == 0 && hasValue)
+      tracePath = argv[++i];
+    else if (std::strcmp(argv[i], "--perft") == 0 && hasValue) {
+      if (!parseNumber(argv[++i], perftDepth) || perftDepth < 1) {
+        std::cerr << "--perft needs a whole depth of at least 1, got " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--difftest") == 0 && hasValue) {
+      if (!parseNumber(argv[++i], diffTestGames) || diffTestGames < 1) {
+        std::cerr << "--difftest needs a whole number of games of at least 1, got " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--pieces") == 0 && hasValue) {
+      if (!loadPieceDefinitions(argv[++i]))
+        return 1;
+    } else { // anything else is a typo or an option missing its value, don't silently start the game
+      std::cerr << "Unknown option or missing value: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  // leave room for both back ranks and both pawn rows
+  if (backRank.empty() || height < 4) {
+    std::cerr << "Board needs at least one column and four rows" << std::endl;
+    return 1;
+  }
+  // every setup letter must name a piece, checked after parsing so --pieces may come after --setup
+  for (char letter : backRank) {
+    IGamePiece *piece = createPiece(letter, true, 0, 0);
+    if (piece == nullptr) {
+      std::cerr << "Unknown piece letter '" << letter << "' in setup " << backRank << std::endl;
+      return 1;
+    }
+    delete piece;
+  }
+  boardManager.prepareBoard(backRank, height); // populate chessboard
+  if (perftDepth > 0)
+    return runPerft(perftDepth);
+  if (diffTestGames > 0)
+    return runDiffTest(diffTestGames, backRank, height);
+  tracer.enabled = tracePath != nullptr;
+  // writeTrace saves the trace file when tracing was requested, reporting failures on std::cerr
+  auto writeTrace = [&]() {
+    if (tracePath != nullptr && !tracer.write(tracePath))
+      std::cerr << "Could not write trace file: " << tracePath << std::endl;
+  };
+  if (replayScript != nullptr) {
+    int result = runReplay(replayScript);
+    writeTrace();
+    return result;
+  }
+
 #ifndef _WIN32              // the next line only runs on non-windows systems
   system("stty raw -echo"); // Disable line buffering and echo on linux/macos
 #else
@@ -600,69 +2335,15 @@ int main() {
   printf("\033[?25l");   // hide the cursor
   printf("\033[?1049h"); // use alternate screen buffer
   // populate terminal before starting...
-  std::cout << BG_BLACK << RESET; // Clear screen and use dark background
-  printf("Controls: Arrow Keys, Space to Select ('q' to quit)\n\r");
-  boardManager.prepareBoard();      // populate chessboard
-  Position cursor = Position(0, 0); // start cursor in top left corner
-
-  IGamePiece *selectedPiece = nullptr; // reference to the currently selected gamePiece, start deselected
-  std::vector<Position> moves;         // vector of potential moves for the selectedPiece
-
-  boardManager.renderBoard(cursor, selectedPiece, moves); // print the initial board to the console
-
-  while (true) {             // user interaction loop
-    std::string status = ""; // reset status text after any interaction
-    char c = std::cin.get(); // wait for keyboard input
-    // ... after user enters a key.
-    std::cout << BG_BLACK << RESET;                                             // Clear screen and use dark background
-    printf("Controls: Arrow Keys, Space to Select ('q' to quit)\n\r"); // print help text at top
-    // process user input
-    if (c == '\033') { // if control characterwas pressed, we need to capture the following control characters and process them
-      char seq1 = std::cin.get();
-      char seq2 = std::cin.get();
-      if (seq1 == '[') { // control character may be an arrow if sequence starts with `\033[`
-        switch (seq2) {  // if arrow key was pressed, move cursor around the board
-        case 'A':        // up arrow
-          cursor.y = std::clamp(cursor.y - 1, 0, 7);
-          break;
-        case 'B': // down arrow
-          cursor.y = std::clamp(cursor.y + 1, 0, 7);
-          break;
-        case 'C': // right arrow
-          cursor.x = std::clamp(cursor.x + 1, 0, 7);
-          break;
-        case 'D': // left arrow
-          cursor.x = std::clamp(cursor.x - 1, 0, 7);
-          break;
-        }
-        if (selectedPiece != nullptr) // if a piece is currently selected, add its name to the status message
-          status += selectedPiece->getName() + " selected";
-      }
-    } else if (c == 'q' || c == 3) { // quit on 'q' or ctrl+c
-      printf("\033[?25h");           // show the cursor
-      printf("\033[?1049l");         // Restore the main screen buffer
-      system("stty sane");           // Restore terminal settings
-      printf("Exiting...\n");
-      break;
-    } else if (c == ' ') {                                 // "select" (space or return key pressed)
-      if (selectedPiece != nullptr) {                      // if a piece is currently selected
-        if (boardManager.movePiece(selectedPiece, cursor)) // attempt move if a potential move position is selected
-          status += "Moved " + selectedPiece->getName();
-        else
-          status += "Deselected";
-        selectedPiece = nullptr; // clear the selectedPiece and the potential moves list after any selection is made
-        moves = std::vector<Position>();
-      } else {                                                           // if a piece is not currently selected
-        if (boardManager.getAtPosition(cursor.x, cursor.y) == nullptr) { // do nothing but update status message if an empty space is selected
-          status += "Empty space selected";
-        } else { // set the selectedPiece reference and update the potentialmoves list for the piece
-          selectedPiece = boardManager.getAtPosition(cursor.x, cursor.y);
-          moves = selectedPiece->getPotentialMoves();
-          status += selectedPiece->getName() + " selected";
-        }
-      }
-    }
-    boardManager.renderBoard(cursor, selectedPiece, moves); // render the board and print the status message
-    std::cout << status;
+  UIState state;
+  renderFrame(state, std::cout); // print the initial board to the console
+
+  while (processKey(state, std::cin)) { // user interaction loop, ends on 'q' or ctrl+c
+    renderFrame(state, std::cout);      // render the board and print the status message
   }
-}
\ No newline at end of file
+  printf("\033[?25h");   // show the cursor
+  printf("\033[?1049l"); // Restore the main screen buffer
+  system("stty sane");   // Restore terminal settings
+  printf("Exiting...\n");
+  writeTrace();
+}